@@ -4,12 +4,18 @@
 #include <iostream>
 #include <string>
 #include <memory>
+#include <cstdint>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
 
 enum StringType{
     BINARY, // 二进制
     ASCII,  // ASCII
     BASE64  // Base64
 };
+class FrozenBinary;
 /*
 * 二进制数据类
 * 用于二进制数据的读写操作
@@ -19,6 +25,7 @@ enum StringType{
 class Binary{
     friend Binary& operator<<(Binary&& dest, Binary&& src); 
     friend Binary& operator<<(Binary& dest, Binary& src); 
+    friend class BinaryPipeline;
     public:
     //----------- 构造函数和析构函数 ------------
         // 构造函数，无参数
@@ -109,6 +116,16 @@ class Binary{
         // 判断数据指针是否为空
         virtual bool is_null() const;
 
+    // ------------ 压缩 -------------
+        // 压缩数据，返回帧格式（分块 LZ77 + 每块校验和）的Binary
+        virtual Binary compress() const;
+        // 解压帧格式的数据，直接解码到预先分配好大小的目标数组中
+        virtual Binary decompress() const;
+
+    // ------------ 冻结 -------------
+        // 转换为不可变的FrozenBinary，数据未被其他Binary共享时直接移动而不拷贝，之后当前对象置为无效状态（与移动后相同）
+        virtual FrozenBinary freeze();
+
     // ----------- 静态函数 ------------
         // 将std::byte*类型的数据转换为字符串
         const static std::string BINARY_TO_STRING(const std::vector<std::byte>& data, const size_t size);
@@ -124,7 +141,21 @@ class Binary{
         const static std::vector<std::byte> BASE64_TO_BINARY(const std::string& data);
         // 将多个Binary对象连接起来
         const static Binary contact(std::initializer_list<Binary>&& args);
-    
+        // 压缩单个数据块的最大输出大小
+        static size_t COMPRESS_BOUND(const size_t size);
+        // 压缩单个数据块（不含帧头和校验和），返回写入的字节数，目标空间不足时返回0
+        static size_t COMPRESS_BLOCK(const std::byte* src, const size_t size, std::byte* dst, const size_t capacity);
+        // 解压单个数据块，返回写入的字节数，数据损坏时抛出异常
+        static size_t DECOMPRESS_BLOCK(const std::byte* src, const size_t size, std::byte* dst, const size_t capacity);
+        // 流式压缩，输出与compress()相同的帧格式，内存占用与输入大小无关
+        static void COMPRESS_STREAM(std::istream& in, std::ostream& out);
+        // 流式解压，输入为compress()/COMPRESS_STREAM()产生的帧格式
+        static void DECOMPRESS_STREAM(std::istream& in, std::ostream& out);
+        // 计算数据的XXH32校验和
+        static uint32_t CHECKSUM(const std::byte* data, const size_t size);
+        // 帧格式中每个数据块的原始大小
+        static constexpr size_t COMPRESS_FRAME_BLOCK_SIZE = 256 * 1024;
+
     private:
     // ----------- 成员变量 ------------
         // 二进制数据数组
@@ -137,6 +168,230 @@ Binary& operator<<(Binary&& dest, Binary&& src);
 // 重载<<运算符
 // 要用 operator<< 进行合并，必须定义为非成员函数，否则会因为隐式 this 参数导致编译错误。
 Binary& operator<<(Binary& dest, Binary& src);
+
+/*
+* 有界单生产者单消费者无锁队列
+* 仅允许一个线程push、一个线程pop。try_push/try_pop不等待；push/pop在队列满/空时先短暂自旋，
+* 之后在条件变量上休眠，直到另一端操作队列或cancelled被设置
+*/
+template <typename T>
+class SpscQueue{
+    public:
+        // 构造函数，容量向上取整为2的幂
+        explicit SpscQueue(const size_t capacity);
+        SpscQueue(const SpscQueue&) = delete;
+        SpscQueue& operator=(const SpscQueue&) = delete;
+        // 入队，成功时移走value，队列满时返回false且value不变
+        bool try_push(T& value);
+        // 出队，队列空时返回false
+        bool try_pop(T& value);
+        // 入队，队列满时等待；cancelled被设置时返回false
+        bool push(T& value, const std::atomic<bool>& cancelled);
+        // 出队，队列空时等待；cancelled被设置时返回false
+        bool pop(T& value, const std::atomic<bool>& cancelled);
+        // 唤醒所有在push/pop中等待的线程，设置cancelled后调用
+        void notify_all();
+        // 队列容量
+        size_t capacity() const;
+
+    private:
+        // 休眠前的自旋次数
+        static constexpr size_t SPIN_COUNT = 256;
+        bool push_one(T& value);
+        bool pop_one(T& value);
+        // 另一端有线程休眠时唤醒它
+        void wake();
+        template <typename F>
+        bool wait_until(F&& ready, const std::atomic<bool>& cancelled);
+        std::vector<T> slots;
+        size_t mask;
+        // 生产者和消费者的下标分别放在不同的缓存行，避免伪共享
+        alignas(64) std::atomic<size_t> tail;
+        size_t cached_head;
+        alignas(64) std::atomic<size_t> head;
+        size_t cached_tail;
+        // 休眠等待，只在队列满/空时使用
+        alignas(64) std::atomic<size_t> waiters;
+        std::mutex park_mutex;
+        std::condition_variable park;
+};
+
+/*
+* 多阶段流水线
+* 将输入按固定大小分块，每个阶段在独立线程上并发处理，阶段之间用有界SPSC队列连接（队列满时上游休眠等待，空闲的阶段不占用CPU）。
+* 数据块缓冲区在最后一个阶段写出后回收给读取线程复用，内存占用只与块大小、队列深度和阶段数有关，与输入大小无关。
+* 每个阶段按顺序看到所有数据块，因此可以保存跨块状态；阶段的状态在run之间不会重置，因此每个流水线只能run一次。
+*/
+class BinaryPipeline{
+    public:
+        // 阶段函数，原地变换数据块（可以改变大小），last表示这是最后一个数据块（可能为空）
+        using Stage = std::function<void(std::vector<std::byte>& chunk, bool last)>;
+    //----------- 构造函数 ------------
+        // 构造函数，参数为块大小和每个队列的深度
+        explicit BinaryPipeline(const size_t chunk_size = 64 * 1024, const size_t queue_depth = 4);
+    // ----------- 成员函数 ------------
+        // 追加一个阶段
+        BinaryPipeline& then(Stage stage);
+        // 运行流水线，从in读取数据，经过所有阶段后写入out；任一阶段抛出的异常会在这里重新抛出，再次调用时抛出异常
+        void run(std::istream& in, std::ostream& out);
+        // 获取阶段数量
+        size_t size() const;
+    // ----------- 静态函数 ------------
+        // Base64解码阶段，忽略换行符，分组可以跨块
+        static Stage BASE64_DECODE();
+        // 异或阶段，key在整个数据流上循环，结果与 data ^ key 相同（数据不短于key时）
+        static Stage XOR(const Binary& key);
+        // 校验和阶段，数据原样通过，最后一个块处理完后将整个数据流的XXH32写入result，结果与Binary::CHECKSUM相同
+        static Stage CHECKSUM(uint32_t& result);
+        // 十六进制阶段，将数据转换为小写十六进制字符，与to_hex_string()相同
+        static Stage HEX();
+        // 将Binary变换逐块应用到数据上，变换不能依赖块的边界（如逐块compress()，每块得到一个独立的帧）
+        static Stage TRANSFORM(std::function<Binary(const Binary&)> transform);
+
+    private:
+        size_t chunk_size;
+        size_t queue_depth;
+        std::vector<Stage> stages;
+        // 是否已经run过，阶段中保存的跨块状态只能用于一个数据流
+        bool ran;
+};
+
+/*
+* 不可变的二进制数据
+* 由Binary::freeze()生成，创建后数据不再改变，多个线程可以不加锁同时读取；大小和XXH32哈希在创建时计算好
+*/
+class FrozenBinary{
+    friend class Binary;
+    public:
+    //----------- 构造函数 ------------
+        // 构造函数，无参数，空数据
+        FrozenBinary();
+        // 拷贝只增加存储的引用计数；不声明移动操作，移动时退化为拷贝，被移动的对象仍然完整有效
+        FrozenBinary(const FrozenBinary& other) = default;
+        FrozenBinary& operator=(const FrozenBinary& other) = default;
+    // ----------- 运算符重载 ------------
+        // 等于运算符，先比较大小和哈希
+        bool operator==(const FrozenBinary& other) const;
+        // 不等于运算符
+        bool operator!=(const FrozenBinary& other) const;
+        // 下标运算符，参数为size_t类型
+        std::byte operator[](const size_t index) const;
+    // ----------- 成员函数 ------------
+        // 数据指针
+        const std::byte* data() const;
+        // 数据大小
+        size_t size() const;
+        // XXH32哈希，与Binary::CHECKSUM相同
+        uint32_t hash() const;
+        // 判断数据是否为空
+        bool empty() const;
+        // 获取数据，参数为size_t类型
+        std::byte get(const size_t index) const;
+        // 读取数据，参数为size_t类型
+        std::vector<std::byte> read(const size_t index, const size_t size) const;
+        // 读取数据，无参数
+        std::vector<std::byte> read() const;
+        // 将数据转换为十六进制字符串
+        std::string to_hex_string() const;
+        // 将数据转换为Base64字符串
+        std::string to_base64_string() const;
+        // 拷贝为可修改的Binary
+        Binary thaw() const;
+
+    private:
+        // 构造函数，接管data的存储
+        explicit FrozenBinary(std::vector<std::byte>&& data);
+        std::shared_ptr<const std::vector<std::byte>> storage;
+        const std::byte* bytes;
+        size_t length;
+        uint32_t digest;
+};
+
+/*
+* FrozenBinary的原子发布容器（RCU风格）
+* 写线程用store()发布新快照；读线程用read()访问当前快照，读路径只写本线程的hazard pointer，
+* 不修改共享的引用计数，因此多核并发读取不会争用同一缓存行。旧快照在没有读线程引用后由写线程回收。
+*/
+class AtomicFrozenBinary{
+    public:
+    //----------- 构造函数和析构函数 ------------
+        // 构造函数，参数为初始快照
+        explicit AtomicFrozenBinary(const FrozenBinary& value = FrozenBinary());
+        AtomicFrozenBinary(const AtomicFrozenBinary&) = delete;
+        AtomicFrozenBinary& operator=(const AtomicFrozenBinary&) = delete;
+        // 析构函数，调用时不能有其他线程在读写
+        ~AtomicFrozenBinary();
+    // ----------- 成员函数 ------------
+        // 在当前快照上调用f(const FrozenBinary&)并返回其结果，不增加引用计数；f中不要保存快照的引用
+        template <typename F>
+        decltype(auto) read(F&& f) const;
+        // 获取当前快照的拷贝（增加引用计数），可以长期持有
+        FrozenBinary load() const;
+        // 发布新快照
+        void store(const FrozenBinary& value);
+
+    private:
+        // 加锁读取当前快照，本线程没有可用的hazard pointer时使用
+        FrozenBinary load_locked() const;
+        std::atomic<const FrozenBinary*> current;
+        mutable std::mutex writer_mutex;
+        // 已被替换但可能仍有读线程在访问的快照
+        std::vector<const FrozenBinary*> retired;
+};
+
+namespace std{
+    template <>
+    struct hash<FrozenBinary>{
+        size_t operator()(const FrozenBinary& value) const{
+            return value.hash();
+        }
+    };
+}
+
+// 每个线程的hazard pointer记录数量，超出的线程走加锁路径
+constexpr size_t FROZEN_HAZARD_RECORDS = 128;
+// 每个线程允许嵌套read()的层数
+constexpr size_t FROZEN_HAZARD_DEPTH = 4;
+
+// 一个线程的hazard pointer，独占一个缓存行
+struct alignas(64) FrozenHazardRecord{
+    std::atomic<bool> owned;
+    size_t depth;
+    std::atomic<const void*> hazards[FROZEN_HAZARD_DEPTH];
+};
+
+// 全部hazard pointer记录
+FrozenHazardRecord* frozen_hazard_records();
+// 当前线程的hazard pointer记录，记录用尽时返回nullptr
+FrozenHazardRecord* frozen_hazard_record();
+
+template <typename F>
+decltype(auto) AtomicFrozenBinary::read(F&& f) const{
+    FrozenHazardRecord* record = frozen_hazard_record();
+    if (record == nullptr || record->depth == FROZEN_HAZARD_DEPTH){
+        const FrozenBinary snapshot = this->load_locked();
+        return f(snapshot);
+    }
+    std::atomic<const void*>& hazard = record->hazards[record->depth++];
+    // 发布hazard pointer后再次确认快照仍是当前值，之后写线程不会回收它
+    const FrozenBinary* snapshot = this->current.load(std::memory_order_acquire);
+    for (;;){
+        hazard.store(snapshot, std::memory_order_seq_cst);
+        const FrozenBinary* now = this->current.load(std::memory_order_seq_cst);
+        if (now == snapshot)
+            break;
+        snapshot = now;
+    }
+    struct Release{
+        std::atomic<const void*>& hazard;
+        size_t& depth;
+        ~Release(){
+            hazard.store(nullptr, std::memory_order_release);
+            depth--;
+        }
+    } release{hazard, record->depth};
+    return f(*snapshot);
+}
 #endif
 
 #include <iostream>
@@ -150,6 +405,10 @@ Binary& operator<<(Binary& dest, Binary& src);
 #include <utility>
 #include <algorithm>
 #include <iterator>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <exception>
 
 Binary::Binary(){
     this->binary_array = std::make_shared<std::vector<std::byte>>(0); 
@@ -421,11 +680,19 @@ std::string byteToHex(std::byte b) {
     return ss.str();
 }
 
-std::string byteArrayToHexString(const std::vector<std::byte>& data, size_t size) {
-    std::string hexString;
+// 将size个字节转换为2*size个小写十六进制字符写入out
+void bytesToHex(const std::byte* data, size_t size, char* out) {
+    static constexpr char hex_chars[] = "0123456789abcdef";
     for (size_t i = 0; i < size; i++) {
-        hexString += byteToHex(data[i]);
+        const unsigned char b = static_cast<unsigned char>(data[i]);
+        out[2 * i] = hex_chars[b >> 4];
+        out[2 * i + 1] = hex_chars[b & 0x0F];
     }
+}
+
+std::string byteArrayToHexString(const std::vector<std::byte>& data, size_t size) {
+    std::string hexString(2 * size, '\0');
+    bytesToHex(data.data(), size, hexString.data());
     return hexString;
 }
 
@@ -522,14 +789,13 @@ std::string Binary::to_ascll_string() const{
     return BINARY_TO_ASCll(*this->binary_array, this->binary_array->size());
 }
 
-std::string base64_encode(const std::vector<std::byte>& input) {
+std::string base64_encode(const std::byte* input, size_t input_len) {
     static constexpr char base64_chars[] = 
         "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
         "abcdefghijklmnopqrstuvwxyz"
         "0123456789+/";
 
-    const unsigned char* data = reinterpret_cast<const unsigned char*>(input.data());
-    size_t input_len = input.size();
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(input);
     std::string output;
     output.reserve(4 * ((input_len + 2) / 3)); // 预分配空间
     for (size_t i = 0; i < input_len; i += 3) {
@@ -560,6 +826,10 @@ std::string base64_encode(const std::vector<std::byte>& input) {
     return output;
 }
 
+std::string base64_encode(const std::vector<std::byte>& input) {
+    return base64_encode(input.data(), input.size());
+}
+
 std::vector<std::byte> base64_to_bytes(const std::string& input) {
     const std::string base64_chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
     
@@ -670,4 +940,1019 @@ bool Binary::empty() const{
 
 bool Binary::is_null() const{
     return this->binary_array == nullptr;
-}
\ No newline at end of file
+}
+
+// ----------- 压缩 ------------
+// 块格式与LZ4块格式相同：token(高4位字面量长度，低4位匹配长度-4) + 字面量 + 2字节偏移 + 扩展长度
+// 帧格式：魔数"BLZ1"，之后每块为 原始大小(4字节) + 存储大小(4字节，最高位为1表示未压缩) + 数据 + XXH32校验和(4字节)，
+// 以原始大小为0的4字节结束标记结尾。所有整数均为小端序。
+constexpr size_t LZ_MIN_MATCH = 4;
+constexpr size_t LZ_LAST_LITERALS = 5;
+constexpr size_t LZ_MFLIMIT = 12;
+constexpr size_t LZ_MAX_OFFSET = 65535;
+constexpr int LZ_HASH_LOG = 14;
+constexpr uint32_t LZ_FRAME_STORED = 0x80000000u;
+constexpr unsigned char LZ_FRAME_MAGIC[4] = {'B', 'L', 'Z', '1'};
+constexpr size_t LZ_FRAME_BLOCK_HEADER = 8;
+constexpr size_t LZ_FRAME_BLOCK_CHECKSUM = 4;
+
+uint32_t lz_read32(const unsigned char* p){
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint64_t lz_read64(const unsigned char* p){
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t lz_load_le32(const unsigned char* p){
+    return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 | static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+void lz_store_le32(unsigned char* p, uint32_t v){
+    p[0] = static_cast<unsigned char>(v);
+    p[1] = static_cast<unsigned char>(v >> 8);
+    p[2] = static_cast<unsigned char>(v >> 16);
+    p[3] = static_cast<unsigned char>(v >> 24);
+}
+
+uint32_t lz_hash(uint32_t sequence){
+    return (sequence * 2654435761u) >> (32 - LZ_HASH_LOG);
+}
+
+// 计算从ip和ref开始的公共前缀长度，ip不超过limit
+size_t lz_count(const unsigned char* ip, const unsigned char* ref, const unsigned char* limit){
+    const unsigned char* start = ip;
+    while (ip + 8 <= limit){
+        if (lz_read64(ip) != lz_read64(ref))
+            break;
+        ip += 8;
+        ref += 8;
+    }
+    while (ip < limit && *ip == *ref){
+        ip++;
+        ref++;
+    }
+    return ip - start;
+}
+
+// 写入token后的扩展长度（长度 >= 15时）
+unsigned char* lz_write_length(unsigned char* op, size_t length){
+    for (; length >= 255; length -= 255)
+        *op++ = 255;
+    *op++ = static_cast<unsigned char>(length);
+    return op;
+}
+
+// 写入一个序列（字面量 + 匹配），目标空间不足时返回nullptr；match_length为0表示最后一个只有字面量的序列
+unsigned char* lz_write_sequence(unsigned char* op, unsigned char* oend, const unsigned char* literals, size_t literal_length, size_t offset, size_t match_length){
+    size_t need = 1 + literal_length + literal_length / 255 + 1;
+    if (match_length != 0)
+        need += 2 + match_length / 255 + 1;
+    if (need > static_cast<size_t>(oend - op))
+        return nullptr;
+    unsigned char* token = op++;
+    *token = static_cast<unsigned char>(std::min<size_t>(literal_length, 15) << 4);
+    if (literal_length >= 15)
+        op = lz_write_length(op, literal_length - 15);
+    // 空输入的指针可能为nullptr，不能传给memcpy
+    if (literal_length != 0)
+        std::memcpy(op, literals, literal_length);
+    op += literal_length;
+    if (match_length == 0)
+        return op;
+    *op++ = static_cast<unsigned char>(offset);
+    *op++ = static_cast<unsigned char>(offset >> 8);
+    size_t ml = match_length - LZ_MIN_MATCH;
+    *token |= static_cast<unsigned char>(std::min<size_t>(ml, 15));
+    if (ml >= 15)
+        op = lz_write_length(op, ml - 15);
+    return op;
+}
+
+size_t lz_compress_block(const unsigned char* src, size_t size, unsigned char* dst, size_t capacity){
+    const unsigned char* ip = src;
+    const unsigned char* anchor = src;
+    const unsigned char* const iend = src + size;
+    unsigned char* op = dst;
+    unsigned char* const oend = dst + capacity;
+
+    if (size > LZ_MFLIMIT){
+        const unsigned char* const mflimit = iend - LZ_MFLIMIT;
+        const unsigned char* const matchlimit = iend - LZ_LAST_LITERALS;
+        // 哈希表保存相对src的位置，单个块可以超过64KiB，因此使用32位
+        std::vector<uint32_t> table(static_cast<size_t>(1) << LZ_HASH_LOG, 0);
+        table[lz_hash(lz_read32(ip))] = 0;
+        ip++;
+        while (ip < mflimit){
+            // 查找匹配，连续未命中时逐渐增大步长以跳过不可压缩的数据
+            const unsigned char* ref;
+            size_t attempts = 1 << 6;
+            size_t step = 1;
+            for (;;){
+                uint32_t h = lz_hash(lz_read32(ip));
+                ref = src + table[h];
+                table[h] = static_cast<uint32_t>(ip - src);
+                if (static_cast<size_t>(ip - ref) <= LZ_MAX_OFFSET && lz_read32(ref) == lz_read32(ip))
+                    break;
+                ip += step;
+                step = attempts++ >> 6;
+                if (ip >= mflimit)
+                    goto last_literals;
+            }
+            // 向前扩展匹配
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]){
+                ip--;
+                ref--;
+            }
+            size_t match_length = LZ_MIN_MATCH + lz_count(ip + LZ_MIN_MATCH, ref + LZ_MIN_MATCH, matchlimit);
+            op = lz_write_sequence(op, oend, anchor, ip - anchor, ip - ref, match_length);
+            if (op == nullptr)
+                return 0;
+            ip += match_length;
+            anchor = ip;
+            if (ip >= mflimit)
+                break;
+            table[lz_hash(lz_read32(ip - 2))] = static_cast<uint32_t>(ip - 2 - src);
+        }
+    }
+last_literals:
+    op = lz_write_sequence(op, oend, anchor, iend - anchor, 0, 0);
+    if (op == nullptr)
+        return 0;
+    return op - dst;
+}
+
+size_t lz_decompress_block(const unsigned char* src, size_t size, unsigned char* dst, size_t capacity){
+    const unsigned char* ip = src;
+    const unsigned char* const iend = src + size;
+    unsigned char* op = dst;
+    unsigned char* const oend = dst + capacity;
+    if (size == 0){
+        throw std::runtime_error(std::string("lz_decompress_block: Empty block") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    while (ip < iend){
+        const unsigned char token = *ip++;
+        size_t literal_length = token >> 4;
+        if (literal_length == 15){
+            unsigned char b;
+            do {
+                if (ip >= iend){
+                    throw std::runtime_error(std::string("lz_decompress_block: Truncated literal length") + __FILE__ + ":" + std::to_string(__LINE__));
+                }
+                b = *ip++;
+                literal_length += b;
+            } while (b == 255);
+        }
+        if (literal_length > static_cast<size_t>(iend - ip) || literal_length > static_cast<size_t>(oend - op)){
+            throw std::runtime_error(std::string("lz_decompress_block: Literal length out of range") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        if (literal_length <= 16 && iend - ip >= 16 && oend - op >= 16){
+            // 短字面量使用定长拷贝，多写的字节会被后续数据覆盖
+            std::memcpy(op, ip, 16);
+        }else if (literal_length != 0){
+            std::memcpy(op, ip, literal_length);
+        }
+        op += literal_length;
+        ip += literal_length;
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2){
+            throw std::runtime_error(std::string("lz_decompress_block: Truncated offset") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        const size_t offset = static_cast<size_t>(ip[0]) | static_cast<size_t>(ip[1]) << 8;
+        ip += 2;
+        if (offset == 0 || offset > static_cast<size_t>(op - dst)){
+            throw std::runtime_error(std::string("lz_decompress_block: Offset out of range") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        size_t match_length = token & 15;
+        if (match_length == 15){
+            unsigned char b;
+            do {
+                if (ip >= iend){
+                    throw std::runtime_error(std::string("lz_decompress_block: Truncated match length") + __FILE__ + ":" + std::to_string(__LINE__));
+                }
+                b = *ip++;
+                match_length += b;
+            } while (b == 255);
+        }
+        match_length += LZ_MIN_MATCH;
+        if (match_length > static_cast<size_t>(oend - op)){
+            throw std::runtime_error(std::string("lz_decompress_block: Match length out of range") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        const unsigned char* ref = op - offset;
+        unsigned char* const mend = op + match_length;
+        if (offset >= 8 && static_cast<size_t>(oend - op) >= match_length + 8){
+            // 每次拷贝8字节，源数据总是已经写出；末尾最多多写7个字节，会被后续数据覆盖
+            do {
+                std::memcpy(op, ref, 8);
+                op += 8;
+                ref += 8;
+            } while (op < mend);
+            op = mend;
+        }else if (offset >= match_length){
+            std::memcpy(op, ref, match_length);
+            op += match_length;
+        }else{
+            for (size_t i = 0; i < match_length; i++)
+                *op++ = *ref++;
+        }
+    }
+    return op - dst;
+}
+
+constexpr uint32_t XXH32_P1 = 2654435761u;
+constexpr uint32_t XXH32_P2 = 2246822519u;
+constexpr uint32_t XXH32_P3 = 3266489917u;
+constexpr uint32_t XXH32_P4 = 668265263u;
+constexpr uint32_t XXH32_P5 = 374761393u;
+
+uint32_t xxh32_rotl(uint32_t v, int bits){
+    return (v << bits) | (v >> (32 - bits));
+}
+
+uint32_t xxh32_round(uint32_t acc, uint32_t input){
+    acc += input * XXH32_P2;
+    return xxh32_rotl(acc, 13) * XXH32_P1;
+}
+
+// XXH32流式计算状态，分多次update的结果与一次性计算相同
+struct Xxh32State{
+    uint64_t total = 0;
+    uint32_t v[4];
+    unsigned char buffer[16];
+    size_t buffered = 0;
+    uint32_t seed;
+    explicit Xxh32State(uint32_t seed = 0) : v{seed + XXH32_P1 + XXH32_P2, seed + XXH32_P2, seed, seed - XXH32_P1}, seed(seed) {}
+};
+
+const unsigned char* xxh32_consume(Xxh32State& state, const unsigned char* p, const unsigned char* end){
+    for (; p + 16 <= end; p += 16){
+        state.v[0] = xxh32_round(state.v[0], lz_read32(p));
+        state.v[1] = xxh32_round(state.v[1], lz_read32(p + 4));
+        state.v[2] = xxh32_round(state.v[2], lz_read32(p + 8));
+        state.v[3] = xxh32_round(state.v[3], lz_read32(p + 12));
+    }
+    return p;
+}
+
+void xxh32_update(Xxh32State& state, const unsigned char* p, size_t size){
+    // 空数据的指针可能为nullptr，不能传给memcpy
+    if (size == 0)
+        return;
+    const unsigned char* const end = p + size;
+    state.total += size;
+    if (state.buffered + size < 16){
+        std::memcpy(state.buffer + state.buffered, p, size);
+        state.buffered += size;
+        return;
+    }
+    if (state.buffered != 0){
+        const size_t fill = 16 - state.buffered;
+        std::memcpy(state.buffer + state.buffered, p, fill);
+        xxh32_consume(state, state.buffer, state.buffer + 16);
+        p += fill;
+        state.buffered = 0;
+    }
+    p = xxh32_consume(state, p, end);
+    state.buffered = end - p;
+    std::memcpy(state.buffer, p, state.buffered);
+}
+
+uint32_t xxh32_digest(const Xxh32State& state){
+    uint32_t h;
+    if (state.total >= 16){
+        h = xxh32_rotl(state.v[0], 1) + xxh32_rotl(state.v[1], 7) + xxh32_rotl(state.v[2], 12) + xxh32_rotl(state.v[3], 18);
+    }else{
+        h = state.seed + XXH32_P5;
+    }
+    h += static_cast<uint32_t>(state.total);
+    const unsigned char* p = state.buffer;
+    const unsigned char* const end = state.buffer + state.buffered;
+    for (; p + 4 <= end; p += 4){
+        h += lz_read32(p) * XXH32_P3;
+        h = xxh32_rotl(h, 17) * XXH32_P4;
+    }
+    for (; p < end; p++){
+        h += *p * XXH32_P5;
+        h = xxh32_rotl(h, 11) * XXH32_P1;
+    }
+    h ^= h >> 15;
+    h *= XXH32_P2;
+    h ^= h >> 13;
+    h *= XXH32_P3;
+    h ^= h >> 16;
+    return h;
+}
+
+uint32_t xxh32(const unsigned char* p, size_t size, uint32_t seed = 0){
+    Xxh32State state(seed);
+    xxh32_update(state, p, size);
+    return xxh32_digest(state);
+}
+
+// 将一个原始数据块编码为帧中的一个块，out至少需要 LZ_FRAME_BLOCK_HEADER + size + LZ_FRAME_BLOCK_CHECKSUM 字节
+size_t lz_frame_write_block(const unsigned char* raw, size_t size, unsigned char* out){
+    unsigned char* payload = out + LZ_FRAME_BLOCK_HEADER;
+    size_t stored = lz_compress_block(raw, size, payload, size);
+    uint32_t stored_field = static_cast<uint32_t>(stored);
+    if (stored == 0){
+        // 不可压缩的数据按原样存储
+        std::memcpy(payload, raw, size);
+        stored = size;
+        stored_field = static_cast<uint32_t>(size) | LZ_FRAME_STORED;
+    }
+    lz_store_le32(out, static_cast<uint32_t>(size));
+    lz_store_le32(out + 4, stored_field);
+    lz_store_le32(payload + stored, xxh32(raw, size));
+    return LZ_FRAME_BLOCK_HEADER + stored + LZ_FRAME_BLOCK_CHECKSUM;
+}
+
+// 检查块头是否合理：LZ4序列的膨胀率不超过约255:1，在分配目标空间前拒绝声称过大原始大小的块
+bool lz_frame_check_block(uint32_t raw_size, uint32_t stored_field){
+    const size_t stored = stored_field & ~LZ_FRAME_STORED;
+    if (raw_size > Binary::COMPRESS_FRAME_BLOCK_SIZE || stored == 0)
+        return false;
+    if (stored_field & LZ_FRAME_STORED)
+        return stored == raw_size;
+    return raw_size <= stored * 255 + 16;
+}
+
+// 解码帧中一个块的数据部分到dst，并校验校验和
+void lz_frame_read_block(const unsigned char* payload, uint32_t stored_field, const unsigned char* checksum, unsigned char* dst, size_t size){
+    size_t stored = stored_field & ~LZ_FRAME_STORED;
+    if (stored_field & LZ_FRAME_STORED){
+        if (stored != size){
+            throw std::runtime_error(std::string("lz_frame_read_block: Stored block size mismatch") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        std::memcpy(dst, payload, size);
+    }else if (lz_decompress_block(payload, stored, dst, size) != size){
+        throw std::runtime_error(std::string("lz_frame_read_block: Block size mismatch") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    if (xxh32(dst, size) != lz_load_le32(checksum)){
+        throw std::runtime_error(std::string("lz_frame_read_block: Checksum mismatch") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+}
+
+size_t Binary::COMPRESS_BOUND(const size_t size){
+    return size + size / 255 + 16;
+}
+
+size_t Binary::COMPRESS_BLOCK(const std::byte* src, const size_t size, std::byte* dst, const size_t capacity){
+    return lz_compress_block(reinterpret_cast<const unsigned char*>(src), size, reinterpret_cast<unsigned char*>(dst), capacity);
+}
+
+size_t Binary::DECOMPRESS_BLOCK(const std::byte* src, const size_t size, std::byte* dst, const size_t capacity){
+    return lz_decompress_block(reinterpret_cast<const unsigned char*>(src), size, reinterpret_cast<unsigned char*>(dst), capacity);
+}
+
+uint32_t Binary::CHECKSUM(const std::byte* data, const size_t size){
+    return xxh32(reinterpret_cast<const unsigned char*>(data), size);
+}
+
+Binary Binary::compress() const{
+    if (this->binary_array == nullptr){
+        throw std::runtime_error(std::string("Binary::compress: Binary array is null") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    const unsigned char* raw = reinterpret_cast<const unsigned char*>(this->binary_array->data());
+    const size_t size = this->binary_array->size();
+    const size_t blocks = (size + COMPRESS_FRAME_BLOCK_SIZE - 1) / COMPRESS_FRAME_BLOCK_SIZE;
+    // 按最坏情况（每块都未压缩存储）分配，最后截断到实际大小
+    auto result = std::make_shared<std::vector<std::byte>>(sizeof(LZ_FRAME_MAGIC) + size + blocks * (LZ_FRAME_BLOCK_HEADER + LZ_FRAME_BLOCK_CHECKSUM) + 4);
+    unsigned char* out = reinterpret_cast<unsigned char*>(result->data());
+    std::memcpy(out, LZ_FRAME_MAGIC, sizeof(LZ_FRAME_MAGIC));
+    size_t pos = sizeof(LZ_FRAME_MAGIC);
+    for (size_t offset = 0; offset < size; offset += COMPRESS_FRAME_BLOCK_SIZE){
+        pos += lz_frame_write_block(raw + offset, std::min(COMPRESS_FRAME_BLOCK_SIZE, size - offset), out + pos);
+    }
+    lz_store_le32(out + pos, 0);
+    pos += 4;
+    result->resize(pos);
+    result->shrink_to_fit();
+    return Binary(result);
+}
+
+Binary Binary::decompress() const{
+    if (this->binary_array == nullptr){
+        throw std::runtime_error(std::string("Binary::decompress: Binary array is null") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(this->binary_array->data());
+    const size_t size = this->binary_array->size();
+    if (size < sizeof(LZ_FRAME_MAGIC) || std::memcmp(in, LZ_FRAME_MAGIC, sizeof(LZ_FRAME_MAGIC)) != 0){
+        throw std::runtime_error(std::string("Binary::decompress: Invalid frame magic") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    // 先遍历块头计算原始大小，一次性分配目标数组
+    size_t total = 0;
+    size_t pos = sizeof(LZ_FRAME_MAGIC);
+    for (;;){
+        if (size - pos < 4){
+            throw std::runtime_error(std::string("Binary::decompress: Truncated frame") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        const uint32_t raw_size = lz_load_le32(in + pos);
+        if (raw_size == 0)
+            break;
+        if (size - pos < LZ_FRAME_BLOCK_HEADER){
+            throw std::runtime_error(std::string("Binary::decompress: Truncated frame") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        const uint32_t stored_field = lz_load_le32(in + pos + 4);
+        if (!lz_frame_check_block(raw_size, stored_field)){
+            throw std::runtime_error(std::string("Binary::decompress: Invalid block header") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        const size_t stored = stored_field & ~LZ_FRAME_STORED;
+        if (size - pos - LZ_FRAME_BLOCK_HEADER < stored + LZ_FRAME_BLOCK_CHECKSUM){
+            throw std::runtime_error(std::string("Binary::decompress: Truncated frame") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        total += raw_size;
+        pos += LZ_FRAME_BLOCK_HEADER + stored + LZ_FRAME_BLOCK_CHECKSUM;
+    }
+    // std::vector分配时会清零，之后被解码结果整体覆盖
+    auto result = std::make_shared<std::vector<std::byte>>(total);
+    unsigned char* out = reinterpret_cast<unsigned char*>(result->data());
+    pos = sizeof(LZ_FRAME_MAGIC);
+    for (size_t written = 0; written < total;){
+        const uint32_t raw_size = lz_load_le32(in + pos);
+        const uint32_t stored_field = lz_load_le32(in + pos + 4);
+        const unsigned char* payload = in + pos + LZ_FRAME_BLOCK_HEADER;
+        const size_t stored = stored_field & ~LZ_FRAME_STORED;
+        lz_frame_read_block(payload, stored_field, payload + stored, out + written, raw_size);
+        written += raw_size;
+        pos += LZ_FRAME_BLOCK_HEADER + stored + LZ_FRAME_BLOCK_CHECKSUM;
+    }
+    return Binary(result);
+}
+
+// 从流中读取size字节，返回实际读取的字节数
+size_t lz_stream_read(std::istream& in, unsigned char* data, size_t size){
+    in.read(reinterpret_cast<char*>(data), static_cast<std::streamsize>(size));
+    return static_cast<size_t>(in.gcount());
+}
+
+void Binary::COMPRESS_STREAM(std::istream& in, std::ostream& out){
+    std::vector<unsigned char> raw(COMPRESS_FRAME_BLOCK_SIZE);
+    std::vector<unsigned char> block(LZ_FRAME_BLOCK_HEADER + COMPRESS_FRAME_BLOCK_SIZE + LZ_FRAME_BLOCK_CHECKSUM);
+    out.write(reinterpret_cast<const char*>(LZ_FRAME_MAGIC), sizeof(LZ_FRAME_MAGIC));
+    for (;;){
+        const size_t size = lz_stream_read(in, raw.data(), raw.size());
+        if (size == 0)
+            break;
+        const size_t length = lz_frame_write_block(raw.data(), size, block.data());
+        out.write(reinterpret_cast<const char*>(block.data()), static_cast<std::streamsize>(length));
+        if (size < raw.size())
+            break;
+    }
+    unsigned char end_mark[4];
+    lz_store_le32(end_mark, 0);
+    out.write(reinterpret_cast<const char*>(end_mark), sizeof(end_mark));
+    if (!out){
+        throw std::runtime_error(std::string("Binary::COMPRESS_STREAM: Write failed") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+}
+
+void Binary::DECOMPRESS_STREAM(std::istream& in, std::ostream& out){
+    unsigned char magic[sizeof(LZ_FRAME_MAGIC)];
+    if (lz_stream_read(in, magic, sizeof(magic)) != sizeof(magic) || std::memcmp(magic, LZ_FRAME_MAGIC, sizeof(magic)) != 0){
+        throw std::runtime_error(std::string("Binary::DECOMPRESS_STREAM: Invalid frame magic") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    std::vector<unsigned char> block;
+    std::vector<unsigned char> raw;
+    for (;;){
+        unsigned char header[LZ_FRAME_BLOCK_HEADER];
+        if (lz_stream_read(in, header, 4) != 4){
+            throw std::runtime_error(std::string("Binary::DECOMPRESS_STREAM: Truncated frame") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        const uint32_t raw_size = lz_load_le32(header);
+        if (raw_size == 0)
+            break;
+        if (lz_stream_read(in, header + 4, 4) != 4){
+            throw std::runtime_error(std::string("Binary::DECOMPRESS_STREAM: Truncated frame") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        const uint32_t stored_field = lz_load_le32(header + 4);
+        const size_t stored = stored_field & ~LZ_FRAME_STORED;
+        if (!lz_frame_check_block(raw_size, stored_field) || stored > COMPRESS_BOUND(COMPRESS_FRAME_BLOCK_SIZE)){
+            throw std::runtime_error(std::string("Binary::DECOMPRESS_STREAM: Invalid block header") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        block.resize(stored + LZ_FRAME_BLOCK_CHECKSUM);
+        raw.resize(raw_size);
+        if (lz_stream_read(in, block.data(), block.size()) != block.size()){
+            throw std::runtime_error(std::string("Binary::DECOMPRESS_STREAM: Truncated frame") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        lz_frame_read_block(block.data(), stored_field, block.data() + stored, raw.data(), raw_size);
+        out.write(reinterpret_cast<const char*>(raw.data()), static_cast<std::streamsize>(raw_size));
+    }
+    if (!out){
+        throw std::runtime_error(std::string("Binary::DECOMPRESS_STREAM: Write failed") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+}
+
+
+// ----------- 流水线 ------------
+template <typename T>
+SpscQueue<T>::SpscQueue(const size_t capacity) : tail(0), cached_head(0), head(0), cached_tail(0), waiters(0){
+    size_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+    this->slots.resize(size);
+    this->mask = size - 1;
+}
+
+template <typename T>
+bool SpscQueue<T>::push_one(T& value){
+    const size_t t = this->tail.load(std::memory_order_relaxed);
+    if (t - this->cached_head > this->mask){
+        this->cached_head = this->head.load(std::memory_order_acquire);
+        if (t - this->cached_head > this->mask)
+            return false;
+    }
+    this->slots[t & this->mask] = std::move(value);
+    this->tail.store(t + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+bool SpscQueue<T>::pop_one(T& value){
+    const size_t h = this->head.load(std::memory_order_relaxed);
+    if (h == this->cached_tail){
+        this->cached_tail = this->tail.load(std::memory_order_acquire);
+        if (h == this->cached_tail)
+            return false;
+    }
+    value = std::move(this->slots[h & this->mask]);
+    this->head.store(h + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+void SpscQueue<T>::wake(){
+    // 与wait_until中的栅栏配对：要么等待方看到这次操作，要么这里看到等待方
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (this->waiters.load(std::memory_order_relaxed) != 0)
+        this->notify_all();
+}
+
+template <typename T>
+void SpscQueue<T>::notify_all(){
+    // 加锁保证等待方要么还没检查条件，要么已经在wait中
+    { std::lock_guard<std::mutex> lock(this->park_mutex); }
+    this->park.notify_all();
+}
+
+template <typename T>
+template <typename F>
+bool SpscQueue<T>::wait_until(F&& ready, const std::atomic<bool>& cancelled){
+    for (size_t i = 0; i < SPIN_COUNT; i++){
+        if (ready())
+            return true;
+        if (cancelled.load(std::memory_order_acquire))
+            return false;
+    }
+    bool done = false;
+    {
+        std::unique_lock<std::mutex> lock(this->park_mutex);
+        this->waiters.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        for (;;){
+            if (ready()){
+                done = true;
+                break;
+            }
+            if (cancelled.load(std::memory_order_acquire))
+                break;
+            this->park.wait(lock);
+        }
+        this->waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return done;
+}
+
+template <typename T>
+bool SpscQueue<T>::try_push(T& value){
+    if (!this->push_one(value))
+        return false;
+    this->wake();
+    return true;
+}
+
+template <typename T>
+bool SpscQueue<T>::try_pop(T& value){
+    if (!this->pop_one(value))
+        return false;
+    this->wake();
+    return true;
+}
+
+template <typename T>
+bool SpscQueue<T>::push(T& value, const std::atomic<bool>& cancelled){
+    if (!this->wait_until([&](){ return this->push_one(value); }, cancelled))
+        return false;
+    this->wake();
+    return true;
+}
+
+template <typename T>
+bool SpscQueue<T>::pop(T& value, const std::atomic<bool>& cancelled){
+    if (!this->wait_until([&](){ return this->pop_one(value); }, cancelled))
+        return false;
+    this->wake();
+    return true;
+}
+
+template <typename T>
+size_t SpscQueue<T>::capacity() const{
+    return this->slots.size();
+}
+
+// 在线程之间传递的数据块
+struct PipelineChunk{
+    std::vector<std::byte> data;
+    bool last = false;
+};
+
+BinaryPipeline::BinaryPipeline(const size_t chunk_size, const size_t queue_depth){
+    if (chunk_size == 0 || queue_depth == 0){
+        throw std::invalid_argument(std::string("BinaryPipeline: Chunk size and queue depth must be positive") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    this->chunk_size = chunk_size;
+    this->queue_depth = queue_depth;
+    this->ran = false;
+}
+
+BinaryPipeline& BinaryPipeline::then(Stage stage){
+    if (!stage){
+        throw std::invalid_argument(std::string("BinaryPipeline::then: Stage is empty") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    this->stages.push_back(std::move(stage));
+    return *this;
+}
+
+size_t BinaryPipeline::size() const{
+    return this->stages.size();
+}
+
+void BinaryPipeline::run(std::istream& in, std::ostream& out){
+    if (this->ran){
+        throw std::runtime_error(std::string("BinaryPipeline::run: Pipeline has already run, stage state cannot be reused") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    this->ran = true;
+    const size_t stage_count = this->stages.size();
+    // 每个队列最多queue_depth个块，每个线程手中最多一个块
+    const size_t buffer_count = this->queue_depth * (stage_count + 1) + stage_count + 2;
+    // queues[i]连接第i个阶段的上游和第i个阶段，queues[stage_count]连接最后一个阶段和写出线程
+    std::vector<std::unique_ptr<SpscQueue<PipelineChunk>>> queues;
+    for (size_t i = 0; i <= stage_count; i++)
+        queues.push_back(std::make_unique<SpscQueue<PipelineChunk>>(this->queue_depth));
+    // 写出线程把用完的缓冲区还给读取线程
+    SpscQueue<std::vector<std::byte>> recycle(buffer_count);
+
+    std::atomic<bool> failed(false);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto fail = [&](){
+        {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error)
+                error = std::current_exception();
+            failed.store(true, std::memory_order_release);
+        }
+        // 唤醒所有休眠的线程，让它们看到failed后退出
+        for (auto& queue : queues)
+            queue->notify_all();
+        recycle.notify_all();
+    };
+
+    std::vector<std::thread> threads;
+    threads.emplace_back([&](){
+        try {
+            size_t created = 0;
+            for (;;){
+                PipelineChunk chunk;
+                // 优先复用写出线程归还的缓冲区，缓冲区总数达到上限后等待归还
+                if (!recycle.try_pop(chunk.data)){
+                    if (created < buffer_count)
+                        created++;
+                    else if (!recycle.pop(chunk.data, failed))
+                        return;
+                }
+                chunk.data.resize(this->chunk_size);
+                in.read(reinterpret_cast<char*>(chunk.data.data()), static_cast<std::streamsize>(this->chunk_size));
+                if (in.bad()){
+                    throw std::runtime_error(std::string("BinaryPipeline::run: Read failed") + __FILE__ + ":" + std::to_string(__LINE__));
+                }
+                const size_t size = static_cast<size_t>(in.gcount());
+                chunk.data.resize(size);
+                chunk.last = size < this->chunk_size;
+                if (!queues[0]->push(chunk, failed) || chunk.last)
+                    return;
+            }
+        } catch (...) {
+            fail();
+        }
+    });
+    for (size_t i = 0; i < stage_count; i++){
+        threads.emplace_back([&, i](){
+            try {
+                for (;;){
+                    PipelineChunk chunk;
+                    if (!queues[i]->pop(chunk, failed))
+                        return;
+                    this->stages[i](chunk.data, chunk.last);
+                    const bool last = chunk.last;
+                    if (!queues[i + 1]->push(chunk, failed) || last)
+                        return;
+                }
+            } catch (...) {
+                fail();
+            }
+        });
+    }
+    try {
+        for (;;){
+            PipelineChunk chunk;
+            if (!queues[stage_count]->pop(chunk, failed))
+                break;
+            out.write(reinterpret_cast<const char*>(chunk.data.data()), static_cast<std::streamsize>(chunk.data.size()));
+            if (!out){
+                throw std::runtime_error(std::string("BinaryPipeline::run: Write failed") + __FILE__ + ":" + std::to_string(__LINE__));
+            }
+            if (chunk.last)
+                break;
+            recycle.push(chunk.data, failed);
+        }
+    } catch (...) {
+        fail();
+    }
+    for (auto& thread : threads)
+        thread.join();
+    if (error)
+        std::rethrow_exception(error);
+}
+
+BinaryPipeline::Stage BinaryPipeline::BASE64_DECODE(){
+    struct State{
+        std::array<int, 256> decode_table;
+        unsigned char group[4];
+        size_t count = 0;
+        bool finished = false;
+        std::vector<std::byte> scratch;
+    };
+    auto state = std::make_shared<State>();
+    const std::string base64_chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    state->decode_table.fill(-1);
+    for (int i = 0; i < 64; ++i)
+        state->decode_table[static_cast<unsigned char>(base64_chars[i])] = i;
+    return [state](std::vector<std::byte>& chunk, bool last){
+        // 解码到备用缓冲区后交换，两个缓冲区都会被复用
+        std::vector<std::byte>& output = state->scratch;
+        output.resize((state->count + chunk.size()) / 4 * 3);
+        size_t w = 0;
+        for (const std::byte b : chunk){
+            const unsigned char c = static_cast<unsigned char>(b);
+            if (c == '\r' || c == '\n')
+                continue;
+            if (state->finished){
+                throw std::invalid_argument(std::string("BinaryPipeline::BASE64_DECODE: Data after padding") + __FILE__ + ":" + std::to_string(__LINE__));
+            }
+            state->group[state->count++] = c;
+            if (state->count < 4)
+                continue;
+            state->count = 0;
+            const unsigned char* g = state->group;
+            const int a = state->decode_table[g[0]], bb = state->decode_table[g[1]];
+            const int cc = g[2] == '=' ? 0 : state->decode_table[g[2]];
+            const int d = g[3] == '=' ? 0 : state->decode_table[g[3]];
+            if (a == -1 || bb == -1 || cc == -1 || d == -1){
+                throw std::invalid_argument(std::string("BinaryPipeline::BASE64_DECODE: Invalid character in Base64 string") + __FILE__ + ":" + std::to_string(__LINE__));
+            }
+            if (g[2] == '=' && g[3] != '='){
+                throw std::invalid_argument(std::string("BinaryPipeline::BASE64_DECODE: Invalid padding with '='") + __FILE__ + ":" + std::to_string(__LINE__));
+            }
+            const uint32_t triplet = static_cast<uint32_t>(a) << 18 | static_cast<uint32_t>(bb) << 12 | static_cast<uint32_t>(cc) << 6 | static_cast<uint32_t>(d);
+            output[w++] = static_cast<std::byte>((triplet >> 16) & 0xFF);
+            if (g[2] != '=')
+                output[w++] = static_cast<std::byte>((triplet >> 8) & 0xFF);
+            if (g[3] != '=')
+                output[w++] = static_cast<std::byte>(triplet & 0xFF);
+            else
+                state->finished = true;
+        }
+        if (last && state->count != 0){
+            throw std::invalid_argument(std::string("BinaryPipeline::BASE64_DECODE: Base64 string length must be a multiple of 4") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        output.resize(w);
+        chunk.swap(output);
+    };
+}
+
+BinaryPipeline::Stage BinaryPipeline::XOR(const Binary& key){
+    if (key.binary_array == nullptr || key.binary_array->empty()){
+        throw std::invalid_argument(std::string("BinaryPipeline::XOR: Key is empty") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    auto mask = std::make_shared<std::vector<std::byte>>(*key.binary_array);
+    auto phase = std::make_shared<size_t>(0);
+    return [mask, phase](std::vector<std::byte>& chunk, bool){
+        const std::byte* k = mask->data();
+        const size_t key_size = mask->size();
+        size_t j = *phase;
+        for (std::byte& b : chunk){
+            b ^= k[j];
+            if (++j == key_size)
+                j = 0;
+        }
+        *phase = j;
+    };
+}
+
+BinaryPipeline::Stage BinaryPipeline::CHECKSUM(uint32_t& result){
+    auto state = std::make_shared<Xxh32State>();
+    uint32_t* target = &result;
+    return [state, target](std::vector<std::byte>& chunk, bool last){
+        xxh32_update(*state, reinterpret_cast<const unsigned char*>(chunk.data()), chunk.size());
+        if (last)
+            *target = xxh32_digest(*state);
+    };
+}
+
+BinaryPipeline::Stage BinaryPipeline::HEX(){
+    auto scratch = std::make_shared<std::vector<std::byte>>();
+    return [scratch](std::vector<std::byte>& chunk, bool){
+        scratch->resize(2 * chunk.size());
+        bytesToHex(chunk.data(), chunk.size(), reinterpret_cast<char*>(scratch->data()));
+        chunk.swap(*scratch);
+    };
+}
+
+BinaryPipeline::Stage BinaryPipeline::TRANSFORM(std::function<Binary(const Binary&)> transform){
+    if (!transform){
+        throw std::invalid_argument(std::string("BinaryPipeline::TRANSFORM: Transform is empty") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    return [transform](std::vector<std::byte>& chunk, bool){
+        auto input = std::make_shared<std::vector<std::byte>>(std::move(chunk));
+        const Binary result = transform(Binary(input));
+        if (result.binary_array == nullptr){
+            throw std::runtime_error(std::string("BinaryPipeline::TRANSFORM: Binary array is null") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        // 取回原缓冲区再写入结果，保持缓冲区复用
+        chunk.swap(*input);
+        if (result.binary_array == input)
+            return;
+        chunk.assign(result.binary_array->begin(), result.binary_array->end());
+    };
+}
+
+
+// ----------- 冻结 ------------
+FrozenBinary Binary::freeze(){
+    if (this->binary_array == nullptr){
+        throw std::runtime_error(std::string("Binary::freeze: Binary array is null") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    // 其他Binary仍共享数据时只能拷贝，否则它们会看到被移走的数组
+    std::vector<std::byte> data = this->binary_array.use_count() == 1 ? std::move(*this->binary_array) : *this->binary_array;
+    this->binary_array = nullptr;
+    return FrozenBinary(std::move(data));
+}
+
+FrozenBinary::FrozenBinary() : FrozenBinary(std::vector<std::byte>()) {}
+
+FrozenBinary::FrozenBinary(std::vector<std::byte>&& data){
+    auto storage = std::make_shared<const std::vector<std::byte>>(std::move(data));
+    this->bytes = storage->data();
+    this->length = storage->size();
+    this->digest = xxh32(reinterpret_cast<const unsigned char*>(this->bytes), this->length);
+    this->storage = std::move(storage);
+}
+
+bool FrozenBinary::operator==(const FrozenBinary& other) const{
+    if (this->length != other.length || this->digest != other.digest)
+        return false;
+    // 空数据的指针可能为nullptr，不能传给memcmp
+    if (this->length == 0)
+        return true;
+    return this->bytes == other.bytes || std::memcmp(this->bytes, other.bytes, this->length) == 0;
+}
+
+bool FrozenBinary::operator!=(const FrozenBinary& other) const{
+    return !(*this == other);
+}
+
+std::byte FrozenBinary::operator[](const size_t index) const{
+    return this->get(index);
+}
+
+const std::byte* FrozenBinary::data() const{
+    return this->bytes;
+}
+
+size_t FrozenBinary::size() const{
+    return this->length;
+}
+
+uint32_t FrozenBinary::hash() const{
+    return this->digest;
+}
+
+bool FrozenBinary::empty() const{
+    return this->length == 0;
+}
+
+std::byte FrozenBinary::get(const size_t index) const{
+    if (index >= this->length){
+        throw std::runtime_error(std::string("FrozenBinary::get: Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    return this->bytes[index];
+}
+
+std::vector<std::byte> FrozenBinary::read(const size_t index, const size_t size) const{
+    if (index >= this->length)
+        return {};
+    return std::vector<std::byte>(this->bytes + index, this->bytes + index + std::min(size, this->length - index));
+}
+
+std::vector<std::byte> FrozenBinary::read() const{
+    return std::vector<std::byte>(this->bytes, this->bytes + this->length);
+}
+
+std::string FrozenBinary::to_hex_string() const{
+    std::string hexString(2 * this->length, '\0');
+    bytesToHex(this->bytes, this->length, hexString.data());
+    return hexString;
+}
+
+std::string FrozenBinary::to_base64_string() const{
+    return base64_encode(this->bytes, this->length);
+}
+
+Binary FrozenBinary::thaw() const{
+    return Binary(this->bytes, this->length);
+}
+
+FrozenHazardRecord* frozen_hazard_records(){
+    static FrozenHazardRecord records[FROZEN_HAZARD_RECORDS];
+    return records;
+}
+
+FrozenHazardRecord* frozen_hazard_record(){
+    // 线程第一次读取时占用一条记录，线程退出时归还
+    struct Owner{
+        FrozenHazardRecord* record = nullptr;
+        Owner(){
+            FrozenHazardRecord* records = frozen_hazard_records();
+            for (size_t i = 0; i < FROZEN_HAZARD_RECORDS; i++){
+                bool expected = false;
+                if (records[i].owned.compare_exchange_strong(expected, true, std::memory_order_acquire)){
+                    this->record = &records[i];
+                    this->record->depth = 0;
+                    break;
+                }
+            }
+        }
+        ~Owner(){
+            if (this->record != nullptr)
+                this->record->owned.store(false, std::memory_order_release);
+        }
+    };
+    thread_local Owner owner;
+    return owner.record;
+}
+
+AtomicFrozenBinary::AtomicFrozenBinary(const FrozenBinary& value) : current(new FrozenBinary(value)) {}
+
+AtomicFrozenBinary::~AtomicFrozenBinary(){
+    delete this->current.load(std::memory_order_relaxed);
+    for (const FrozenBinary* snapshot : this->retired)
+        delete snapshot;
+}
+
+FrozenBinary AtomicFrozenBinary::load() const{
+    return this->read([](const FrozenBinary& snapshot){ return snapshot; });
+}
+
+FrozenBinary AtomicFrozenBinary::load_locked() const{
+    // 回收只在持有锁时进行，所以持锁期间当前快照一定有效
+    std::lock_guard<std::mutex> lock(this->writer_mutex);
+    return *this->current.load(std::memory_order_acquire);
+}
+
+void AtomicFrozenBinary::store(const FrozenBinary& value){
+    const FrozenBinary* next = new FrozenBinary(value);
+    std::lock_guard<std::mutex> lock(this->writer_mutex);
+    this->retired.push_back(this->current.exchange(next, std::memory_order_seq_cst));
+    // 回收不再被任何hazard pointer引用的旧快照
+    std::vector<const void*> protected_snapshots;
+    FrozenHazardRecord* records = frozen_hazard_records();
+    for (size_t i = 0; i < FROZEN_HAZARD_RECORDS; i++){
+        for (size_t j = 0; j < FROZEN_HAZARD_DEPTH; j++){
+            const void* hazard = records[i].hazards[j].load(std::memory_order_seq_cst);
+            if (hazard != nullptr)
+                protected_snapshots.push_back(hazard);
+        }
+    }
+    auto reclaimable = std::partition(this->retired.begin(), this->retired.end(), [&](const FrozenBinary* snapshot){
+        return std::find(protected_snapshots.begin(), protected_snapshots.end(), snapshot) != protected_snapshots.end();
+    });
+    for (auto it = reclaimable; it != this->retired.end(); ++it)
+        delete *it;
+    this->retired.erase(reclaimable, this->retired.end());
+}
@@ -1,5 +1,99 @@
 #include "binary.hpp"
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <thread>
 
+// 生成压缩基准测试用的数据
+Binary make_benchmark_data(const std::string& kind, size_t size){
+    std::mt19937 rng(42);
+    Binary data(0);
+    if (kind == "log text"){
+        const char* levels[] = {"INFO", "WARN", "DEBUG", "ERROR"};
+        for (size_t i = 0; data.size() < size; i++){
+            std::string line = "2025-03-18 12:" + std::to_string(i / 60 % 60) + ":" + std::to_string(i % 60) + " [" + levels[rng() % 4] + "] request id=" + std::to_string(rng() % 100000) + " path=/api/v1/items/" + std::to_string(rng() % 1000) + " status=200\n";
+            data.append(Binary::ASCll_TO_BINARY(line));
+        }
+    }else if (kind == "records"){
+        for (uint32_t i = 0; data.size() < size; i++){
+            uint32_t record[4] = {i, 0x12345678u, static_cast<uint32_t>(rng() % 256), i * 3};
+            data.append(sizeof(record), reinterpret_cast<const std::byte*>(record));
+        }
+    }else if (kind == "base64"){
+        Binary raw(size * 3 / 4);
+        for (size_t i = 0; i < raw.size(); i++)
+            raw[i] = static_cast<std::byte>(rng() % 16);
+        data = Binary(raw.to_base64_string(), StringType::ASCII);
+    }else{
+        data.resize(size);
+        for (size_t i = 0; i < size; i++)
+            data[i] = static_cast<std::byte>(rng());
+    }
+    data.resize(size);
+    return data;
+}
+
+// 测量ratio和GB/s，便于权衡CPU与网络/磁盘字节
+void benchmark_compress(const std::string& kind, size_t size){
+    using clock = std::chrono::steady_clock;
+    const int rounds = 5;
+    Binary data = make_benchmark_data(kind, size);
+    Binary compressed(0), restored(0);
+    std::vector<std::byte> raw = data.read(), copy(size);
+    double compress_seconds = 1e9, decompress_seconds = 1e9, copy_seconds = 1e9;
+    for (int i = 0; i < rounds; i++){
+        auto t0 = clock::now();
+        compressed = data.compress();
+        auto t1 = clock::now();
+        restored = compressed.decompress();
+        auto t2 = clock::now();
+        std::memcpy(copy.data(), raw.data(), size);
+        auto t3 = clock::now();
+        compress_seconds = std::min(compress_seconds, std::chrono::duration<double>(t1 - t0).count());
+        decompress_seconds = std::min(decompress_seconds, std::chrono::duration<double>(t2 - t1).count());
+        copy_seconds = std::min(copy_seconds, std::chrono::duration<double>(t3 - t2).count());
+    }
+    std::cout << std::left << std::setw(10) << kind << std::right << std::fixed << std::setprecision(2)
+              << " ratio: " << std::setw(6) << static_cast<double>(size) / compressed.size()
+              << "  compress: " << std::setw(6) << size / compress_seconds / 1e9 << " GB/s"
+              << "  decompress: " << std::setw(6) << size / decompress_seconds / 1e9 << " GB/s"
+              << "  memcpy: " << std::setw(6) << size / copy_seconds / 1e9 << " GB/s"
+              << (restored.read() == raw ? "" : "  MISMATCH") << std::endl;
+}
+
+
+// 对比流水线与逐步生成中间Binary的方式：Base64解码 -> 异或 -> 校验和 -> 十六进制
+void benchmark_pipeline(size_t size){
+    using clock = std::chrono::steady_clock;
+    Binary key("5a17c3e9", StringType::BINARY);
+    std::string text = make_benchmark_data("random", size).to_base64_string();
+
+    auto t0 = clock::now();
+    Binary decoded(text, StringType::BASE64);
+    Binary unmasked = decoded ^ key;
+    uint32_t chain_checksum = Binary::CHECKSUM(unmasked.read().data(), unmasked.size());
+    std::string chain_hex = unmasked.to_hex_string();
+    auto t1 = clock::now();
+
+    std::stringstream in(text), out;
+    uint32_t pipeline_checksum = 0;
+    BinaryPipeline pipeline;
+    pipeline.then(BinaryPipeline::BASE64_DECODE())
+            .then(BinaryPipeline::XOR(key))
+            .then(BinaryPipeline::CHECKSUM(pipeline_checksum))
+            .then(BinaryPipeline::HEX());
+    auto t2 = clock::now();
+    pipeline.run(in, out);
+    auto t3 = clock::now();
+
+    std::cout << std::fixed << std::setprecision(2)
+              << "chain:    " << text.size() / std::chrono::duration<double>(t1 - t0).count() / 1e9 << " GB/s" << std::endl
+              << "pipeline: " << text.size() / std::chrono::duration<double>(t3 - t2).count() / 1e9 << " GB/s"
+              << " (" << pipeline.size() << " stages, " << std::thread::hardware_concurrency() << " cores)"
+              << (pipeline_checksum == chain_checksum && out.str() == chain_hex ? "" : "  MISMATCH") << std::endl;
+}
 
 int main(void){
     Binary binary1("Hello World", StringType::ASCII);
@@ -28,5 +122,40 @@ int main(void){
     std::cout << "binary7 ascll string: " << binary7.to_ascll_string() << std::endl;
     std::cout << "-------------------------------------------------"<< std::endl;
     std::cout << Binary::contact({std::move(binary1), std::move(binary2), std::move(binary3)} ).to_ascll_string() << std::endl;
+    std::cout << "-------------------------------------------------"<< std::endl;
+    Binary binary8 = Binary("Hello World Hello World Hello World", StringType::ASCII).compress();
+    std::cout << "binary8 compressed hex string: " << binary8.to_hex_string() << std::endl;
+    std::cout << "binary8 decompressed ascll string: " << binary8.decompress().to_ascll_string() << std::endl;
+    std::vector<std::byte> empty_input, empty_block(Binary::COMPRESS_BOUND(0));
+    size_t empty_block_size = Binary::COMPRESS_BLOCK(empty_input.data(), 0, empty_block.data(), empty_block.size());
+    std::cout << "empty block size: " << empty_block_size
+              << " decompressed size: " << Binary::DECOMPRESS_BLOCK(empty_block.data(), empty_block_size, empty_input.data(), 0) << std::endl;
+    std::stringstream raw_stream("Hello World Hello World Hello World"), compressed_stream, restored_stream;
+    Binary::COMPRESS_STREAM(raw_stream, compressed_stream);
+    Binary::DECOMPRESS_STREAM(compressed_stream, restored_stream);
+    std::cout << "stream decompressed string: " << restored_stream.str() << std::endl;
+    std::cout << "-------------------------------------------------"<< std::endl;
+    for (const std::string kind : {"log text", "records", "base64", "random"})
+        benchmark_compress(kind, 16 * 1024 * 1024);
+    std::cout << "-------------------------------------------------"<< std::endl;
+    benchmark_pipeline(16 * 1024 * 1024);
+    std::cout << "-------------------------------------------------"<< std::endl;
+    Binary binary9("Hello World", StringType::ASCII);
+    FrozenBinary frozen = binary9.freeze();
+    std::cout << "frozen size: " << frozen.size() << " hash: " << std::hex << frozen.hash() << std::dec
+              << " binary9 is null: " << binary9.is_null() << std::endl;
+    AtomicFrozenBinary current(frozen);
+    std::vector<std::thread> readers;
+    std::atomic<size_t> total_reads(0);
+    for (int i = 0; i < 4; i++){
+        readers.emplace_back([&current, &total_reads](){
+            for (int j = 0; j < 100000; j++)
+                total_reads += current.read([](const FrozenBinary& snapshot){ return snapshot.size() > 0; });
+        });
+    }
+    current.store(Binary("Hello Frozen World", StringType::ASCII).freeze());
+    for (auto& reader : readers)
+        reader.join();
+    std::cout << "reads: " << total_reads << " current: " << current.load().thaw().to_ascll_string() << std::endl;
     return 0;
 }
\ No newline at end of file